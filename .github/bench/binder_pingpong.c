@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Binder round-trip latency benchmark.
+ *
+ * A forked child becomes the context manager and replies to every
+ * transaction; the parent sends empty transactions to handle 0 and times
+ * each round trip. Prints one "BENCH-BINDER <json>" line per run; all runs
+ * share the one server, so none of them has to become the context manager
+ * while the previous one is still being released.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/android/binder.h>
+#include <linux/android/binderfs.h>
+
+#define MAP_SIZE (1024 * 1024)
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "binder_pingpong: %s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/* Creates the device through binder-control if binderfs lacks it. */
+static void create_device(const char *path)
+{
+	struct binderfs_device device = { 0 };
+	char dir[256], name[256], control[512];
+	int fd;
+
+	if (access(path, F_OK) == 0)
+		return;
+	snprintf(dir, sizeof(dir), "%s", path);
+	snprintf(name, sizeof(name), "%s", path);
+	snprintf(control, sizeof(control), "%s/binder-control", dirname(dir));
+	snprintf(device.name, sizeof(device.name), "%s", basename(name));
+
+	fd = open(control, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		die("open binder-control");
+	if (ioctl(fd, BINDER_CTL_ADD, &device) < 0)
+		die("BINDER_CTL_ADD");
+	close(fd);
+}
+
+static int open_binder(const char *path)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		die("open");
+	if (ioctl(fd, BINDER_VERSION, &version) < 0)
+		die("BINDER_VERSION");
+	if (version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder_pingpong: protocol version %d\n",
+			version.protocol_version);
+		exit(1);
+	}
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		die("mmap");
+	return fd;
+}
+
+static void write_read(int fd, void *wbuf, size_t wsize, void *rbuf,
+		       size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_size = wsize,
+		.write_buffer = (binder_uintptr_t)wbuf,
+		.read_size = rsize,
+		.read_buffer = (binder_uintptr_t)rbuf,
+	};
+
+	/* The driver resumes from write_consumed when the call is repeated. */
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	}
+	*consumed = bwr.read_consumed;
+}
+
+/*
+ * Looks for a transaction or reply in a read buffer. Returns its data, or
+ * NULL if the buffer only held other commands.
+ */
+static const struct binder_transaction_data *
+find_transaction(const char *buf, size_t size, uint32_t want)
+{
+	const char *ptr = buf;
+
+	while (ptr + sizeof(uint32_t) <= buf + size) {
+		uint32_t cmd = *(const uint32_t *)ptr;
+
+		ptr += sizeof(uint32_t);
+		if (cmd == want)
+			return (const struct binder_transaction_data *)ptr;
+		if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY) {
+			fprintf(stderr, "binder_pingpong: transaction failed\n");
+			exit(1);
+		}
+		ptr += _IOC_SIZE(cmd);
+	}
+	return NULL;
+}
+
+static void serve(const char *path, int ready)
+{
+	uint32_t enter = BC_ENTER_LOOPER;
+	char rbuf[256];
+	size_t n;
+	int fd;
+
+	fd = open_binder(path);
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR");
+	write_read(fd, &enter, sizeof(enter), NULL, 0, &n);
+	if (write(ready, "", 1) != 1)
+		die("write");
+	close(ready);
+
+	for (;;) {
+		const struct binder_transaction_data *tr;
+		struct {
+			uint32_t free_cmd;
+			binder_uintptr_t buffer;
+			uint32_t reply_cmd;
+			struct binder_transaction_data reply;
+		} __attribute__((packed)) out = {
+			.free_cmd = BC_FREE_BUFFER,
+			.reply_cmd = BC_REPLY,
+		};
+
+		write_read(fd, NULL, 0, rbuf, sizeof(rbuf), &n);
+		tr = find_transaction(rbuf, n, BR_TRANSACTION);
+		if (!tr)
+			continue;
+		out.buffer = tr->data.ptr.buffer;
+		write_read(fd, &out, sizeof(out), NULL, 0, &n);
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench(int fd, uint64_t *lat, long iterations)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) txn = {
+		.cmd = BC_TRANSACTION,
+		.tr = { .target.handle = 0, .code = 1 },
+	};
+	uint64_t total = 0;
+	char rbuf[256];
+
+	for (long i = 0; i < iterations; i++) {
+		const struct binder_transaction_data *tr = NULL;
+		struct {
+			uint32_t cmd;
+			binder_uintptr_t buffer;
+		} __attribute__((packed)) fr = { .cmd = BC_FREE_BUFFER };
+		uint64_t start = now_ns();
+		void *wbuf = &txn;
+		size_t wsize = sizeof(txn);
+		size_t n;
+
+		while (!tr) {
+			write_read(fd, wbuf, wsize, rbuf, sizeof(rbuf), &n);
+			wbuf = NULL;
+			wsize = 0;
+			tr = find_transaction(rbuf, n, BR_REPLY);
+		}
+		lat[i] = now_ns() - start;
+		total += lat[i];
+
+		fr.buffer = tr->data.ptr.buffer;
+		write_read(fd, &fr, sizeof(fr), NULL, 0, &n);
+	}
+
+	qsort(lat, iterations, sizeof(*lat), cmp_u64);
+	printf("BENCH-BINDER {\"iterations\": %ld, \"avg_ns\": %llu, "
+	       "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}\n",
+	       iterations, (unsigned long long)(total / iterations),
+	       (unsigned long long)lat[iterations / 2],
+	       (unsigned long long)lat[iterations * 99 / 100],
+	       (unsigned long long)lat[iterations * 999 / 1000]);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "/dev/binderfs/binder";
+	long iterations = argc > 2 ? atol(argv[2]) : 100000;
+	long runs = argc > 3 ? atol(argv[3]) : 1;
+	uint64_t *lat;
+	int pipefd[2];
+	pid_t server;
+	char c;
+	int fd;
+
+	lat = calloc(iterations, sizeof(*lat));
+	if (!lat || iterations <= 0)
+		die("calloc");
+
+	create_device(path);
+	if (pipe(pipefd) < 0)
+		die("pipe");
+	server = fork();
+	if (server < 0)
+		die("fork");
+	if (server == 0) {
+		close(pipefd[0]);
+		serve(path, pipefd[1]);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &c, 1) != 1) {
+		fprintf(stderr, "binder_pingpong: server did not start\n");
+		return 1;
+	}
+
+	fd = open_binder(path);
+	for (long run = 0; run < runs; run++)
+		bench(fd, lat, iterations);
+
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	return 0;
+}
@@ -0,0 +1,135 @@
+import argparse
+import os
+
+# Leaf drivers and samples that nothing else in the tree builds on, with the
+# Kconfig symbol that enables them and the make target that builds them.
+# A symbol ending in '_' matches every symbol with that prefix.
+LEAF_TARGETS = [
+    ("drivers/gpu/nova-core/", "NOVA_CORE", "drivers/gpu/nova-core/"),
+    ("drivers/gpu/drm/nova/", "DRM_NOVA", "drivers/gpu/drm/nova/"),
+    ("drivers/gpu/drm/tyr/", "DRM_TYR", "drivers/gpu/drm/tyr/"),
+    ("drivers/block/rnull/", "BLK_DEV_RUST_NULL", "drivers/block/rnull/"),
+    ("drivers/android/binder/", "ANDROID_BINDER_IPC_RUST", "drivers/android/binder/"),
+    ("drivers/net/phy/ax88796b_rust.rs", "AX88796B_RUST_PHY", "drivers/net/phy/ax88796b_rust.o"),
+    ("drivers/net/phy/qt2025.rs", "AMCC_QT2025_PHY", "drivers/net/phy/qt2025.o"),
+    ("drivers/pwm/pwm_th1520.rs", "PWM_TH1520", "drivers/pwm/pwm_th1520.o"),
+    ("samples/rust/", "SAMPLE_RUST_", "samples/rust/"),
+]
+
+def enabled_symbols(config_path):
+    symbols = set()
+    with open(config_path, "r") as f:
+        for line in f:
+            name, _, value = line.strip().partition("=")
+            if name.startswith("CONFIG_") and value in ("y", "m"):
+                symbols.add(name[len("CONFIG_"):])
+    return symbols
+
+def is_enabled(symbol, symbols):
+    if symbol.endswith("_"):
+        return any(s.startswith(symbol) for s in symbols)
+    return symbol in symbols
+
+def affected_targets(changed, symbols):
+    # Returns the targets to build, or None if a full build is needed.
+    targets = set()
+    for path in changed:
+        # Kconfig changes can reach anywhere through the configuration.
+        if os.path.basename(path).startswith("Kconfig"):
+            print(f"{path}: Kconfig changed, full build")
+            return None
+        for prefix, symbol, target in LEAF_TARGETS:
+            if path == prefix or (prefix.endswith("/") and path.startswith(prefix)):
+                if is_enabled(symbol, symbols):
+                    print(f"{path}: CONFIG_{symbol} -> {target}")
+                    targets.add(target)
+                else:
+                    print(f"{path}: CONFIG_{symbol} is not enabled, nothing to build")
+                break
+        else:
+            print(f"{path}: outside the leaf drivers, full build")
+            return None
+    return sorted(targets)
+
+def rust_objects(out_dir):
+    # Rust objects outside rust/ that the cached build compiled, found
+    # through the source_ line fixdep wrote to their .cmd files.
+    objects = set()
+    for root, dirs, files in os.walk(out_dir):
+        rel = os.path.relpath(root, out_dir)
+        if rel == "rust":
+            dirs[:] = []
+            continue
+        for name in files:
+            if not (name.startswith(".") and name.endswith(".o.cmd")):
+                continue
+            with open(os.path.join(root, name), "r", errors="replace") as f:
+                for line in f:
+                    if line.startswith("source_"):
+                        if line.rstrip().endswith(".rs"):
+                            objects.add(os.path.normpath(os.path.join(rel, name[1:-len(".cmd")])))
+                        break
+    return objects
+
+def lint_targets(changed, build_targets, out_dir):
+    # Returns the targets for clippy, or None to lint the full build.
+    if build_targets:
+        return build_targets
+    objects = rust_objects(out_dir)
+    if not objects:
+        print("No Rust objects in the cached build, linting the full build")
+        return None
+    targets = set(objects)
+    targets.add("rust/")
+    # Changed Rust files that are not themselves an object the cached build
+    # knows, such as new crates, are linted through their directory.
+    for path in changed:
+        if path.endswith(".rs") and not path.startswith("rust/"):
+            if path[:-len(".rs")] + ".o" not in objects:
+                targets.add(os.path.dirname(path) + "/")
+    return sorted(targets)
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Map the paths changed since the cached build to make targets")
+    parser.add_argument("changed", help="changed paths written by timestamp.py --changed")
+    parser.add_argument("config", help="kernel .config")
+    parser.add_argument("output", help="targets to build, empty for a full build")
+    parser.add_argument("--lint-output", metavar="FILE",
+                        help="Rust targets for clippy, empty for the full build")
+    args = parser.parse_args()
+
+    targets = None
+    changed = []
+    if not os.path.exists(args.changed):
+        print("No cached build to compare against, full build")
+    else:
+        with open(args.changed, "r") as f:
+            changed = [line.strip() for line in f if line.strip()]
+        if not changed:
+            print("Nothing changed since the cached build, full build")
+        else:
+            targets = affected_targets(changed, enabled_symbols(args.config))
+            # Only disabled drivers changed, so do the usual build.
+            if targets == []:
+                targets = None
+
+    with open(args.output, "w") as f:
+        for target in targets or []:
+            f.write(target + "\n")
+    if targets:
+        print(f"Building only: {' '.join(targets)}")
+
+    if args.lint_output:
+        out_dir = os.path.dirname(os.path.abspath(args.config))
+        lint = None
+        if os.path.exists(args.changed):
+            lint = lint_targets(changed, targets, out_dir)
+        with open(args.lint_output, "w") as f:
+            for target in lint or []:
+                f.write(target + "\n")
+        if lint:
+            print(f"Linting {len(lint)} Rust targets")
+
+if __name__ == "__main__":
+    main()
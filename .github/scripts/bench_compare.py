@@ -0,0 +1,81 @@
+import argparse
+import json
+import sys
+
+# Module init times below this are not compared
+MIN_INIT_USECS = 1000
+
+# (name, section and field in bench.json, whether a higher value is better)
+METRICS = [
+    ("rnull iops", "fio", "iops", True),
+    ("rnull p99 ns", "fio", "lat_p99_ns", False),
+    ("rnull p99.9 ns", "fio", "lat_p999_ns", False),
+    ("binder p50 ns", "binder", "p50_ns", False),
+    ("binder p99 ns", "binder", "p99_ns", False),
+]
+
+def noise(result, section, field):
+    # Spread of the runs within one boot, relative to their median
+    return result.get("noise", {}).get(f"{section}.{field}", 0.0)
+
+def compare(old, new, threshold):
+    regressions = []
+    print(f"{'Metric':<28} {'Old':>14} {'New':>14} {'Change':>8} {'Limit':>7}")
+    for name, section, field, higher_is_better in METRICS:
+        a = (old.get(section) or {}).get(field)
+        b = (new.get(section) or {}).get(field)
+        if a is None or b is None:
+            continue
+        change = (b - a) / a * 100 if a else 0.0
+        worse = -change if higher_is_better else change
+        # A change within what the runs of either boot spread over is noise.
+        limit = max(threshold, (noise(old, section, field) + noise(new, section, field)) * 100)
+        mark = ""
+        if worse > limit:
+            mark = " <- regression"
+            regressions.append(name)
+        print(f"{name:<28} {a:>14.0f} {b:>14.0f} {change:>+7.1f}% {limit:>6.1f}%{mark}")
+
+    # Module init times are compared for modules loaded by both runs. Those
+    # well under a millisecond are mostly noise, so they are left out.
+    old_mods = old.get("module_init_usecs", {})
+    new_mods = new.get("module_init_usecs", {})
+    for mod in sorted(set(old_mods) & set(new_mods)):
+        a, b = old_mods[mod], new_mods[mod]
+        if max(a, b) < MIN_INIT_USECS:
+            continue
+        change = (b - a) / a * 100 if a else 0.0
+        mark = ""
+        if change > threshold:
+            mark = " <- regression"
+            regressions.append(f"{mod} init")
+        print(f"{mod + ' init us':<28} {a:>14.0f} {b:>14.0f} {change:>+7.1f}% {threshold:>6.1f}%{mark}")
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two bench.json files")
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=15.0,
+                        help="percentage a metric may get worse by, at least (default: 15)")
+    args = parser.parse_args()
+
+    with open(args.old, "r") as f:
+        old = json.load(f)
+    with open(args.new, "r") as f:
+        new = json.load(f)
+
+    # Under TCG the numbers mostly measure the emulator, so only runs with
+    # KVM are compared.
+    if not (old.get("kvm") and new.get("kvm")):
+        print("Not comparing benchmarks that did not both run under KVM.")
+        return
+
+    regressions = compare(old, new, args.threshold)
+    for name in new.get("module_failures", []):
+        print(f"Module failed to load: {name}")
+    if regressions or (new.get("module_failures") and not old.get("module_failures")):
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Build the initramfs booted by the benchmark job: an Ubuntu base with fio,
+# the kernel modules from the build job, and the Binder ping-pong tool.
+#
+# Usage: bench_initramfs.sh <arch> <image-dir>
+#
+# <image-dir> is the unpacked bench-image artifact; the result is written
+# to <image-dir>/initramfs.cpio.gz.
+set -e
+
+ARCH="$1"
+IMAGE_DIR="$2"
+BENCH_DIR="$(dirname "$0")/../bench"
+ROOTFS="$IMAGE_DIR/rootfs"
+
+case "$ARCH" in
+  x86_64)
+    DEBARCH=amd64
+    MIRROR=http://archive.ubuntu.com/ubuntu
+    CC=gcc
+    ;;
+  arm64)
+    DEBARCH=arm64
+    MIRROR=http://ports.ubuntu.com/ubuntu-ports
+    CC=aarch64-linux-gnu-gcc
+    ;;
+  *)
+    echo "Unsupported architecture: $ARCH"
+    exit 1
+    ;;
+esac
+
+sudo mmdebstrap --variant=essential --arch="$DEBARCH" --components=main,universe \
+  --include=fio,kmod noble "$ROOTFS" "$MIRROR"
+
+# Build against the UAPI headers of the kernel under test.
+$CC -O2 -Wall -static -I "$IMAGE_DIR/include" \
+  -o "$IMAGE_DIR/binder_pingpong" "$BENCH_DIR/binder_pingpong.c"
+
+sudo mkdir -p "$ROOTFS/bench"
+sudo cp -a "$IMAGE_DIR/modules/lib/modules" "$ROOTFS/lib/"
+sudo cp "$BENCH_DIR/init" "$ROOTFS/init"
+sudo cp "$BENCH_DIR/rnull.fio" "$IMAGE_DIR/binder_pingpong" "$ROOTFS/bench/"
+
+(cd "$ROOTFS" && sudo find . | sudo cpio -o -H newc --quiet) | gzip -1 > "$IMAGE_DIR/initramfs.cpio.gz"
+sudo rm -rf "$ROOTFS"
@@ -0,0 +1,154 @@
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+# How long a benchmark boot may take before it counts as hung
+TIMEOUT = 900
+
+QEMU = {
+    "x86_64": {
+        "binary": "qemu-system-x86_64",
+        "console": "ttyS0",
+        "args": ["-machine", "q35", "-cpu", "max"],
+    },
+    "arm64": {
+        "binary": "qemu-system-aarch64",
+        "console": "ttyAMA0",
+        "args": ["-machine", "virt", "-cpu", "max"],
+    },
+}
+
+# initcall_debug output, e.g.
+# "initcall rnull_mod_init+0x0/0x10 [rnull_mod] returned 0 after 42 usecs"
+INITCALL = re.compile(r"initcall \S+ \[(\w+)\] returned (-?\d+) after (\d+) usecs")
+
+def kvm_usable(arch):
+    return arch == "x86_64" and os.access("/dev/kvm", os.R_OK | os.W_OK)
+
+def run_qemu(arch, kernel, initrd, log_path):
+    params = QEMU[arch]
+    cmd = [params["binary"], *params["args"],
+           "-m", "2G", "-smp", "2", "-nographic", "-no-reboot",
+           "-kernel", kernel, "-initrd", initrd,
+           # The image is built from generic.config, whose built-in KUnit
+           # suites would otherwise run on every boot and in module init.
+           "-append", f"console={params['console']} rdinit=/init initcall_debug "
+                      "ignore_loglevel panic=-1 kunit.enable=0"]
+    if kvm_usable(arch):
+        cmd += ["-accel", "kvm"]
+    print(" ".join(cmd))
+    with open(log_path, "w") as log:
+        try:
+            subprocess.run(cmd, stdout=log, stderr=subprocess.STDOUT,
+                           stdin=subprocess.DEVNULL, timeout=TIMEOUT)
+        except subprocess.TimeoutExpired:
+            print(f"Error: benchmark boot did not finish in {TIMEOUT} seconds")
+    with open(log_path, "r", errors="replace") as log:
+        return [line.rstrip("\r\n") for line in log]
+
+def parse_fio(text):
+    data = json.loads(text)
+    job = data["jobs"][0]["read"]
+    percentiles = job["clat_ns"].get("percentile", {})
+    return {
+        "iops": job["iops"],
+        "bw_kib": job["bw"],
+        "lat_p50_ns": percentiles.get("50.000000"),
+        "lat_p99_ns": percentiles.get("99.000000"),
+        "lat_p999_ns": percentiles.get("99.900000"),
+    }
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    if len(values) % 2:
+        return values[mid]
+    return (values[mid - 1] + values[mid]) / 2
+
+def summarize(runs, prefix, noise):
+    # The median of every field over the runs, and for each field the
+    # spread of the runs relative to that median.
+    if not runs:
+        return None
+    summary = {}
+    for key in runs[0]:
+        values = [run[key] for run in runs if run.get(key) is not None]
+        if not values:
+            summary[key] = None
+            continue
+        summary[key] = median(values)
+        if summary[key]:
+            noise[f"{prefix}.{key}"] = (max(values) - min(values)) / summary[key]
+    return summary
+
+def parse_log(lines):
+    results = {
+        "completed": False,
+        "module_init_usecs": {},
+        "module_failures": [],
+        "fio": None,
+        "fio_runs": [],
+        "binder": None,
+        "binder_runs": [],
+        "noise": {},
+        "skipped": [],
+    }
+    fio_lines = None
+    for line in lines:
+        m = INITCALL.search(line)
+        if m and int(m.group(2)) == 0:
+            results["module_init_usecs"][m.group(1)] = int(m.group(3))
+        if fio_lines is not None:
+            if line.startswith("BENCH-FIO-END"):
+                try:
+                    results["fio_runs"].append(parse_fio("\n".join(fio_lines)))
+                except (ValueError, KeyError, IndexError) as e:
+                    print(f"Warning: Could not parse fio output: {e}")
+                fio_lines = None
+            else:
+                fio_lines.append(line)
+        elif line.startswith("BENCH-FIO-BEGIN"):
+            fio_lines = []
+        elif line.startswith("BENCH-BINDER "):
+            results["binder_runs"].append(json.loads(line[len("BENCH-BINDER "):]))
+        elif line.startswith("BENCH-MODFAIL "):
+            results["module_failures"].append(line.split(" ", 1)[1])
+        elif line.startswith("BENCH-SKIP "):
+            results["skipped"].append(line.split(" ", 1)[1])
+        elif line.startswith("BENCH-END"):
+            results["completed"] = True
+    results["fio"] = summarize(results["fio_runs"], "fio", results["noise"])
+    results["binder"] = summarize(results["binder_runs"], "binder", results["noise"])
+    return results
+
+def main():
+    parser = argparse.ArgumentParser(description="Boot the benchmark initramfs and collect results")
+    parser.add_argument("--arch", required=True, choices=sorted(QEMU))
+    parser.add_argument("--kernel", required=True)
+    parser.add_argument("--initrd", required=True)
+    parser.add_argument("--output", required=True)
+    args = parser.parse_args()
+
+    out_dir = os.path.dirname(os.path.abspath(args.output))
+    os.makedirs(out_dir, exist_ok=True)
+    lines = run_qemu(args.arch, args.kernel, args.initrd, os.path.join(out_dir, "console.log"))
+
+    results = parse_log(lines)
+    results["arch"] = args.arch
+    # Without KVM the numbers mostly measure the emulator.
+    results["kvm"] = kvm_usable(args.arch)
+    results["sha"] = os.environ.get("GITHUB_SHA")
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+        f.write("\n")
+    print(json.dumps(results, indent=2))
+
+    if not results["completed"]:
+        print("Error: benchmark run did not complete, see console.log")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
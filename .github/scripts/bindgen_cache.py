@@ -0,0 +1,100 @@
+import argparse
+import filecmp
+import glob
+import hashlib
+import os
+import shutil
+
+from timestamp import OUT_DIR, parse_deps
+
+# Directories under out/ holding the output of bindgen
+BINDGEN_DIRS = ["rust/bindings", "rust/uapi"]
+# Plain make prerequisites of the bindgen rules, which fixdep never sees
+BINDGEN_INPUTS = ["rust/bindgen_parameters"]
+
+def generated_files():
+    # Each generated file comes with the .cmd file kbuild keeps its command
+    # line and dependencies in; both are needed for make to accept it.
+    files = []
+    for d in BINDGEN_DIRS:
+        for path in sorted(glob.glob(os.path.join(OUT_DIR, d, "*_generated.rs"))):
+            rel = os.path.relpath(path, OUT_DIR)
+            cmd = os.path.join(d, f".{os.path.basename(rel)}.cmd")
+            if os.path.exists(os.path.join(OUT_DIR, cmd)):
+                files.append((rel, cmd))
+    return files
+
+def key():
+    # Hash every header bindgen read for the previous build, including the
+    # source_ header each command starts from. If one of them changed, the
+    # hash changes too, even if that change adds new includes. Generated
+    # headers are only current after 'make prepare0', so run this after it.
+    srctree = os.path.realpath(".")
+    objtree = os.path.realpath(OUT_DIR)
+    files = generated_files()
+    if not files:
+        return
+    deps = set(os.path.join(srctree, p) for p in BINDGEN_INPUTS)
+    for _, cmd in files:
+        for dep in parse_deps(os.path.join(OUT_DIR, cmd)):
+            deps.add(os.path.realpath(os.path.join(objtree, dep)))
+
+    h = hashlib.sha256()
+    for path in sorted(deps):
+        if path.startswith(srctree + os.sep):
+            name = os.path.relpath(path, srctree)
+        elif path.startswith(objtree + os.sep):
+            name = os.path.join("out", os.path.relpath(path, objtree))
+        else:
+            name = path
+        h.update(name.encode() + b"\0")
+        try:
+            with open(path, "rb") as f:
+                h.update(hashlib.sha256(f.read()).digest())
+        except OSError:
+            h.update(b"missing")
+    print(h.hexdigest())
+
+def stage(cache_dir):
+    for rel, cmd in generated_files():
+        for name in (rel, cmd):
+            dst = os.path.join(cache_dir, name)
+            os.makedirs(os.path.dirname(dst), exist_ok=True)
+            shutil.copy2(os.path.join(OUT_DIR, name), dst)
+
+def restore(cache_dir):
+    # Files that already match keep their time stamps, so the crates built
+    # on top of them are not rebuilt. Replaced files get a fresh time stamp,
+    # which makes them newer than the headers they were generated from.
+    replaced = 0
+    kept = 0
+    for src in glob.glob(os.path.join(cache_dir, "**"), recursive=True):
+        if not os.path.isfile(src):
+            continue
+        dst = os.path.join(OUT_DIR, os.path.relpath(src, cache_dir))
+        if os.path.exists(dst) and filecmp.cmp(src, dst, shallow=False):
+            kept += 1
+            continue
+        os.makedirs(os.path.dirname(dst), exist_ok=True)
+        shutil.copyfile(src, dst)
+        replaced += 1
+    print(f"Restored bindings: {replaced} replaced, {kept} already up to date.")
+
+def main():
+    parser = argparse.ArgumentParser(description="Cache bindgen output by header content")
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("key", help="print the hash of the headers used by bindgen")
+    for name in ("stage", "restore"):
+        p = sub.add_parser(name)
+        p.add_argument("cache_dir")
+    args = parser.parse_args()
+
+    if args.command == "key":
+        key()
+    elif args.command == "stage":
+        stage(args.cache_dir)
+    else:
+        restore(args.cache_dir)
+
+if __name__ == "__main__":
+    main()
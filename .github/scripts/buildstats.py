@@ -0,0 +1,148 @@
+import argparse
+import json
+import os
+import re
+import subprocess
+from datetime import datetime
+
+# Number of slowest objects to list individually
+SLOWEST_COUNT = 50
+
+def step_times():
+    # Steps of this job, as reported by GitHub. Jobs running concurrently
+    # use different runners, so the runner name picks out our own job.
+    repo = os.environ.get("GITHUB_REPOSITORY")
+    run_id = os.environ.get("GITHUB_RUN_ID")
+    attempt = os.environ.get("GITHUB_RUN_ATTEMPT", "1")
+    runner = os.environ.get("RUNNER_NAME")
+    if not (repo and run_id and runner):
+        return []
+
+    cmd = ["gh", "api", "--paginate",
+           f"repos/{repo}/actions/runs/{run_id}/attempts/{attempt}/jobs",
+           "--jq", ".jobs[]"]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(f"Warning: Could not query job steps: {result.stderr.strip()}")
+        return []
+
+    for line in result.stdout.splitlines():
+        job = json.loads(line)
+        if job.get("runner_name") != runner or job.get("status") != "in_progress":
+            continue
+        steps = []
+        for step in job.get("steps", []):
+            started, completed = step.get("started_at"), step.get("completed_at")
+            seconds = None
+            if started and completed:
+                seconds = parse_time(completed) - parse_time(started)
+            steps.append({
+                "name": step["name"],
+                "conclusion": step.get("conclusion"),
+                "seconds": seconds,
+            })
+        return steps
+    return []
+
+def parse_time(value):
+    # GitHub timestamps look like 2025-01-01T12:34:56Z
+    return datetime.strptime(value, "%Y-%m-%dT%H:%M:%SZ").timestamp()
+
+def timestamp_stats(path):
+    stats = {"restored": None, "total": None, "crates": {}}
+    if not path or not os.path.exists(path):
+        return stats
+    with open(path, "r") as f:
+        for line in f:
+            m = re.match(r"Restored timestamps for (\d+)/(\d+) files\.", line)
+            if m:
+                stats["restored"] = int(m.group(1))
+                stats["total"] = int(m.group(2))
+            m = re.match(r"Rust crate (\S+): (.*)", line)
+            if m:
+                stats["crates"][m.group(1)] = m.group(2) == "unchanged"
+    return stats
+
+def object_stats(path):
+    stats = {"count": 0, "seconds": {}, "slowest": []}
+    if not path or not os.path.exists(path):
+        return stats
+    objects = []
+    with open(path, "r") as f:
+        for line in f:
+            parts = line.rstrip("\n").split("\t", 2)
+            if len(parts) != 3:
+                continue
+            ns, tool, source = parts
+            seconds = int(ns) / 1e9
+            objects.append((seconds, tool, source))
+            stats["seconds"][tool] = stats["seconds"].get(tool, 0) + seconds
+    objects.sort(reverse=True)
+    stats["count"] = len(objects)
+    stats["slowest"] = [
+        {"source": source, "tool": tool, "seconds": round(seconds, 3)}
+        for seconds, tool, source in objects[:SLOWEST_COUNT]
+    ]
+    return stats
+
+def sccache_stats():
+    cmd = ["sccache", "--show-stats", "--stats-format=json"]
+    try:
+        result = subprocess.run(cmd, capture_output=True, text=True)
+    except OSError:
+        return None
+    if result.returncode != 0:
+        return None
+    try:
+        return json.loads(result.stdout)
+    except ValueError:
+        return None
+
+def main():
+    parser = argparse.ArgumentParser(description="Collect build statistics of a CI job as JSON")
+    parser.add_argument("--output", required=True)
+    parser.add_argument("--timestamp-log", help="output of timestamp.py")
+    parser.add_argument("--timings", help="per-object timings written by objcache/wrap")
+    parser.add_argument("--cache", action="append", default=[], metavar="NAME=HIT",
+                        help="cache-hit output of an actions/cache step")
+    parser.add_argument("--cache-key", action="append", default=[], metavar="NAME=KEY",
+                        help="cache-matched-key output of an actions/cache/restore step")
+    args = parser.parse_args()
+
+    caches = {}
+    for item in args.cache:
+        name, _, hit = item.partition("=")
+        # Caches that this job does not use have no cache-hit output.
+        if hit:
+            caches[name] = hit == "true"
+    # Caches restored by prefix never report a hit, so record whether any
+    # key matched and which one; "-" means none did.
+    cache_keys = {}
+    for item in args.cache_key:
+        name, _, key = item.partition("=")
+        if key:
+            caches[name] = key != "-"
+            cache_keys[name] = key if key != "-" else None
+
+    stats = {
+        "sha": os.environ.get("GITHUB_SHA"),
+        "run_id": os.environ.get("GITHUB_RUN_ID"),
+        "job": os.environ.get("GITHUB_JOB"),
+        "arch": os.environ.get("MATRIX_ARCH"),
+        "config": os.environ.get("MATRIX_CONFIG"),
+        "rustc": os.environ.get("MATRIX_RUSTC"),
+        "steps": step_times(),
+        "timestamps": timestamp_stats(args.timestamp_log),
+        "caches": caches,
+        "cache_keys": cache_keys,
+        "sccache": sccache_stats(),
+        "objects": object_stats(args.timings),
+    }
+
+    with open(args.output, "w") as f:
+        json.dump(stats, f, indent=2)
+        f.write("\n")
+    print(f"Wrote build statistics to {args.output}")
+
+if __name__ == "__main__":
+    main()
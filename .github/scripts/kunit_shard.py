@@ -0,0 +1,210 @@
+import argparse
+import json
+import os
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+# Lines printed by 'kunit.py exec --list_tests'
+TEST_NAME = re.compile(r"^([^\s.]+)\.([^\s.]+)$")
+# Console timestamps, if CONFIG_PRINTK_TIME is enabled
+PRINTK_TIME = re.compile(r"^\[\s*\d+\.\d+\]\s?")
+TOP_LEVEL_RESULT = re.compile(r"^(ok|not ok) \d+(.*)$")
+
+def common_prefix(names):
+    prefix = os.path.commonprefix(names)
+    # Leave one character to split on when a name equals the prefix.
+    if prefix in names:
+        prefix = prefix[:-1]
+    return prefix
+
+def pack(items, bins):
+    # Greedily put the heaviest item into the lightest bin.
+    loads = [[0, []] for _ in range(bins)]
+    for weight, item in sorted(items, key=lambda x: -x[0]):
+        lightest = min(loads, key=lambda x: x[0])
+        lightest[0] += weight
+        lightest[1].append(item)
+    return [b for b in loads if b[1]]
+
+def char_class(chars):
+    chars = sorted(chars)
+    # A '-' only stands for itself at the end of a class.
+    if "-" in chars:
+        chars.remove("-")
+        chars.append("-")
+    return f"[{''.join(chars)}]"
+
+def suite_units(prefix, names, weights, big):
+    # Units that together match every suite in names and none in big. Each
+    # is (weight, (prefix, char)), standing for the glob prefix[char]*, or
+    # for the suite named prefix alone if char is None.
+    units = []
+    by_char = {}
+    for name in names:
+        if name == prefix:
+            units.append((weights[name], (prefix, None)))
+        else:
+            by_char.setdefault(name[len(prefix)], []).append(name)
+    for c, group in sorted(by_char.items()):
+        if any(b.startswith(prefix + c) for b in big):
+            units.extend(suite_units(prefix + c, group, weights, big))
+        else:
+            units.append((sum(weights[n] for n in group), (prefix, c)))
+    return units
+
+def shard_globs(units):
+    # Units under the same prefix share one glob, and so one boot.
+    globs = []
+    by_prefix = {}
+    for unit in (u for group in units for u in group):
+        if isinstance(unit, str):
+            globs.append(unit)
+            continue
+        prefix, c = unit
+        if c is None:
+            globs.append(prefix)
+        else:
+            by_prefix.setdefault(prefix, []).append(c)
+    for prefix, chars in sorted(by_prefix.items()):
+        globs.append(f"{prefix}{char_class(chars)}*")
+    return globs
+
+def split(shards):
+    suites = {}
+    for line in sys.stdin:
+        m = TEST_NAME.match(line.strip())
+        if m:
+            suites.setdefault(m.group(1), []).append(m.group(2))
+    total = sum(len(tests) for tests in suites.values())
+    if not total:
+        return
+    target = max(1, total // shards)
+
+    # Every glob is a boot of its own. Whole suites are grouped by the
+    # leading characters of their names, so a shard usually needs a single
+    # glob. A suite larger than one shard (such as the Rust doctests) can
+    # only be cut with a character class of its tests, one glob per part.
+    big = set(suite for suite, tests in suites.items() if len(tests) > target)
+    weights = {suite: len(tests) for suite, tests in suites.items()}
+    # The few units below a longer prefix, left over around a big suite,
+    # are kept together so they also end up in one glob.
+    units = []
+    nested = {}
+    for weight, (prefix, c) in suite_units("", sorted(set(suites) - big), weights, big):
+        if prefix and c is not None:
+            group = nested.setdefault(prefix, [0, []])
+            group[0] += weight
+            group[1].append((prefix, c))
+        else:
+            units.append((weight, [(prefix, c)]))
+    units.extend((weight, keys) for weight, keys in nested.values())
+    for suite in sorted(big):
+        tests = suites[suite]
+        prefix = common_prefix(tests)
+        by_char = {}
+        for test in tests:
+            c = test[len(prefix)]
+            by_char[c] = by_char.get(c, 0) + 1
+        parts = -(-len(tests) // target)
+        for weight, chars in pack([(n, c) for c, n in by_char.items()], parts):
+            units.append((weight, [f"{suite}.{prefix}{char_class(chars)}*"]))
+
+    # One line per shard, with the globs it boots in turn.
+    for _, shard in pack(units, shards):
+        print(" ".join(shard_globs(shard)))
+
+def read_ktap(path):
+    # Returns the top-level results of one boot, each with its subtest lines.
+    lines = []
+    plan = None
+    seen = 0
+    started = False
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = PRINTK_TIME.sub("", line.rstrip("\n"))
+            if not started:
+                started = re.match(r"^K?TAP version", line) is not None
+                continue
+            if plan is None:
+                m = re.match(r"^1\.\.(\d+)$", line)
+                if m:
+                    plan = int(m.group(1))
+                continue
+            lines.append(line)
+            if TOP_LEVEL_RESULT.match(line):
+                seen += 1
+                if seen == plan:
+                    break
+    return lines
+
+def flatten(group, prefix=""):
+    for case in group.get("test_cases", []):
+        yield prefix + case["name"], case.get("status", "ERROR")
+    for sub in group.get("sub_groups", []):
+        yield from flatten(sub, prefix + sub["name"] + ".")
+
+def merge(tap_path, junit_path, dirs):
+    results = []
+    count = 0
+    for d in dirs:
+        log = os.path.join(d, "test.log")
+        if not os.path.exists(log):
+            continue
+        for line in read_ktap(log):
+            m = TOP_LEVEL_RESULT.match(line)
+            if m:
+                count += 1
+                line = f"{m.group(1)} {count}{m.group(2)}"
+            results.append(line)
+
+    with open(tap_path, "w") as f:
+        f.write("KTAP version 1\n")
+        f.write(f"1..{count}\n")
+        for line in results:
+            f.write(line + "\n")
+
+    # Suites split across boots are joined again by name.
+    suites = {}
+    for d in dirs:
+        path = os.path.join(d, "results.json")
+        if not os.path.exists(path):
+            continue
+        with open(path, "r") as f:
+            data = json.load(f)
+        for suite in data.get("sub_groups", []):
+            suites.setdefault(suite["name"], []).extend(flatten(suite))
+
+    root = ET.Element("testsuites")
+    for name, cases in sorted(suites.items()):
+        failures = sum(1 for _, status in cases if status in ("FAIL", "ERROR"))
+        skipped = sum(1 for _, status in cases if status == "SKIP")
+        ts = ET.SubElement(root, "testsuite", name=name, tests=str(len(cases)),
+                           failures=str(failures), skipped=str(skipped))
+        for case, status in cases:
+            tc = ET.SubElement(ts, "testcase", classname=name, name=case)
+            if status in ("FAIL", "ERROR"):
+                ET.SubElement(tc, "failure", message=status)
+            elif status == "SKIP":
+                ET.SubElement(tc, "skipped")
+    ET.ElementTree(root).write(junit_path, encoding="utf-8", xml_declaration=True)
+    print(f"Merged {count} suite results from {len(dirs)} boots.")
+
+def main():
+    parser = argparse.ArgumentParser(description="Shard KUnit suites across QEMU boots")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("split", help="turn a --list_tests listing into shard globs")
+    p.add_argument("shards", type=int)
+    p = sub.add_parser("merge", help="merge the results of several boots")
+    p.add_argument("--tap", required=True)
+    p.add_argument("--junit", required=True)
+    p.add_argument("dirs", nargs="+")
+    args = parser.parse_args()
+
+    if args.command == "split":
+        split(args.shards)
+    else:
+        merge(args.tap, args.junit, sorted(args.dirs))
+
+if __name__ == "__main__":
+    main()
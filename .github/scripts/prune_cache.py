@@ -0,0 +1,51 @@
+import glob
+import os
+import shutil
+
+from timestamp import OUT_DIR
+
+# Sources whose objects sccache serves
+CACHED_SOURCES = (".c", ".S")
+# Final images, which are relinked from the objects anyway
+IMAGES = ["vmlinux", "vmlinux.o", ".tmp_vmlinux*"]
+
+def cmd_source(cmd_file):
+    with open(cmd_file, "r", errors="replace") as f:
+        for line in f:
+            if line.startswith("source_"):
+                return line.split(":=", 1)[-1].strip()
+    return None
+
+def main():
+    # Drop what sccache can hand back per object before out/ is cached.
+    # kbuild compiles a Rust object with several --emit options, which
+    # sccache does not cache, so those objects stay in out/.
+    removed = 0
+    size = 0
+    def remove(path):
+        nonlocal removed, size
+        try:
+            size += os.path.getsize(path)
+            os.remove(path)
+            removed += 1
+        except OSError:
+            pass
+
+    for root, dirs, files in os.walk(OUT_DIR):
+        for name in files:
+            path = os.path.join(root, name)
+            if name.endswith(".ko"):
+                remove(path)
+            elif name.startswith(".") and name.endswith(".o.cmd"):
+                source = cmd_source(path)
+                if source and source.endswith(CACHED_SOURCES):
+                    remove(os.path.join(root, name[1:-len(".cmd")]))
+    for pattern in IMAGES:
+        for path in glob.glob(os.path.join(OUT_DIR, pattern)):
+            remove(path)
+    for path in glob.glob(os.path.join(OUT_DIR, "arch", "*", "boot")):
+        shutil.rmtree(path, ignore_errors=True)
+    print(f"Removed {removed} files ({size / 2**20:.0f} MiB) from the build tree.")
+
+if __name__ == "__main__":
+    main()
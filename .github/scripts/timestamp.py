@@ -1,53 +1,107 @@
+import argparse
+import glob
+import hashlib
 import os
 import subprocess
 import sys
 
 OUT_DIR = "../out"
 HASH_FILE = os.path.join(OUT_DIR, "hashes.txt")
+TREE_FILE = os.path.join(OUT_DIR, "tree.txt")
+CRATES_FILE = os.path.join(OUT_DIR, "rust", "crates.txt")
 
-def main():
-    # 1. Load stored hashes from the previous build (restored from cache)
+# Timestamp for "unchanged" files: 2020-01-01 00:00:00 UTC
+# This ensures they are older than any build artifacts in 'out/'
+OLD_TIME = 1577836800
+
+def git(*args):
+    result = subprocess.run(["git", *args], capture_output=True, text=True)
+    if result.returncode != 0:
+        return None
+    return result.stdout
+
+def diff_names(old, new):
+    output = git("diff-tree", "-r", "-z", "--name-only", "--no-renames", old, new)
+    if output is None:
+        print("Error running git diff-tree")
+        sys.exit(1)
+    return set(p for p in output.split("\0") if p)
+
+def base_commit():
+    # submit_ci.sh tests every commit merged with ci/base-fixes. Such merges
+    # are not ancestors of each other, but their first parents are, so the
+    # first parent is what a later build can still find in its history.
+    if git("rev-parse", "--verify", "-q", "HEAD^2") is not None:
+        return "HEAD^1"
+    return "HEAD"
+
+def load_hashes():
     stored_map = {} # path -> hash
     if os.path.exists(HASH_FILE):
         try:
             with open(HASH_FILE, "r") as f:
                 for line in f:
-                    parts = line.strip().split(" ", 1)
-                    if len(parts) == 2:
-                        stored_map[parts[1]] = parts[0]
+                    line = line.rstrip("\n")
+                    if "\t" in line:
+                        # git ls-tree output: <mode> <type> <hash>	<path>
+                        meta, path = line.split("\t", 1)
+                        stored_map[path] = meta.split()[-1]
+                    else:
+                        parts = line.split(" ", 1)
+                        if len(parts) == 2:
+                            stored_map[parts[1]] = parts[0]
         except Exception as e:
             print(f"Warning: Could not read hashes.txt: {e}")
+    return stored_map
+
+def save_state():
+    # Write the listing straight from git; only --full mode has to parse it.
+    try:
+        with open(HASH_FILE, "w") as f:
+            subprocess.run(["git", "ls-tree", "-r", "HEAD"], stdout=f, check=True)
+        # The tree of the base commit, then the paths where HEAD differs
+        # from it.
+        base = base_commit()
+        tree = git("rev-parse", f"{base}^{{tree}}")
+        if tree:
+            with open(TREE_FILE, "w") as f:
+                f.write(tree)
+                for path in sorted(diff_names(base, "HEAD")):
+                    f.write(path + "\n")
+    except Exception as e:
+        print(f"Error writing hashes.txt: {e}")
+
+def age_paths(paths, ref=None):
+    # Feed the paths to touch(1) in bulk instead of one utime call each.
+    # With ref, they get the time stamp of that file instead of OLD_TIME.
+    data = "\0".join(paths).encode()
+    when = ["-r", ref] if ref else ["-d", f"@{OLD_TIME}"]
+    subprocess.run(["xargs", "-0", "-r", "touch", "-c", "-h", *when], input=data)
+
+def restore_full():
+    stored_map = load_hashes()
 
-    # 2. Get current files from git to compare
     # We expect to be running inside the linux submodule directory
-    cmd = ["git", "ls-tree", "-r", "HEAD"]
-    result = subprocess.run(cmd, capture_output=True, text=True)
-    if result.returncode != 0:
+    output = git("ls-tree", "-r", "HEAD")
+    if output is None:
         print("Error running git ls-tree")
         sys.exit(1)
 
-    lines = result.stdout.splitlines()
-    new_hashes = []
-    
-    # Timestamp for "unchanged" files: 2020-01-01 00:00:00 UTC
-    # This ensures they are older than any build artifacts in 'out/'
-    OLD_TIME = 1577836800
-    
     matched_count = 0
     total_count = 0
+    changed = set()
+    if not stored_map:
+        changed = None
 
-    for line in lines:
+    for line in output.splitlines():
         # git ls-tree output: <mode> <type> <hash>	<path>
         try:
             meta, path = line.split("\t", 1)
             meta_parts = meta.split()
             if len(meta_parts) < 3: continue
             obj_hash = meta_parts[2]
-            
-            # Save current state for the next build
-            new_hashes.append(f"{obj_hash} {path}")
             total_count += 1
-            
+
             # If the file content hasn't changed since the cached build,
             # set its timestamp to the past so 'make' considers the cached object valid.
             if path in stored_map and stored_map[path] == obj_hash:
@@ -56,19 +110,244 @@ def main():
                     matched_count += 1
                 except OSError:
                     pass
+            elif changed is not None:
+                changed.add(path)
         except ValueError:
             continue
 
     print(f"Restored timestamps for {matched_count}/{total_count} files.")
+    return changed
+
+def save_changed(path, changed):
+    # Without a previous build there is nothing to compare against, which
+    # is told apart from an empty list by the file not existing.
+    if changed is None:
+        if os.path.exists(path):
+            os.remove(path)
+        return
+    with open(path, "w") as f:
+        for item in sorted(changed):
+            f.write(item + "\n")
+
+def current_hashes(paths):
+    current = {}
+    for i in range(0, len(paths), 1000):
+        output = git("ls-tree", "-z", "HEAD", "--", *paths[i:i + 1000])
+        if output is None:
+            print("Error running git ls-tree")
+            sys.exit(1)
+        for entry in output.split("\0"):
+            if "\t" in entry:
+                meta, path = entry.split("\t", 1)
+                current[path] = meta.split()[-1]
+    return current
+
+def restore_incremental():
+    stored_tree = None
+    overlay = set()
+    if os.path.exists(TREE_FILE):
+        with open(TREE_FILE, "r") as f:
+            lines = f.read().splitlines()
+        if lines:
+            stored_tree = lines[0].strip()
+            overlay = set(p for p in lines[1:] if p)
+
+    # The stored tree is only usable if its objects were fetched; a shallow
+    # checkout often lacks them, in which case compare the stored hashes.
+    if not stored_tree or git("cat-file", "-e", f"{stored_tree}^{{tree}}") is None:
+        print("Stored tree not available, falling back to full comparison.")
+        return restore_full()
+
+    # A path outside both the base diff and the overlays of the two builds
+    # has the content of the base commit in both. The overlay paths are few
+    # (the ci/base-fixes changes), so their hashes are compared one by one.
+    base = base_commit()
+    changed = diff_names(stored_tree, base)
+    overlay = sorted((overlay | diff_names(base, "HEAD")) - changed)
+    if overlay:
+        stored_map = load_hashes()
+        current = current_hashes(overlay)
+        changed.update(p for p in overlay if stored_map.get(p) != current.get(p))
+
+    # The checkout gave every file a fresh mtime, so the unchanged ones
+    # still have to be aged, but without looking at their hashes.
+    files = git("ls-files", "-z")
+    if files is None:
+        print("Error running git ls-files")
+        sys.exit(1)
+    paths = [p for p in files.split("\0") if p]
+    unchanged = [p for p in paths if p not in changed]
+    age_paths(unchanged)
+
+    # Deleted paths are in changed but not in the tree.
+    print(f"Restored timestamps for {len(unchanged)}/{len(paths)} files.")
+    return changed
+
+def restore_from_changed(path):
+    # The configure job has already compared against the cached build and
+    # saved the new state, so comparing again would find nothing changed.
+    # Use its list instead: the changed files get the time stamp of that
+    # list, which is older than what configure rebuilt but newer than the
+    # stale output that came with the cache.
+    files = git("ls-files", "-z")
+    if files is None:
+        print("Error running git ls-files")
+        sys.exit(1)
+    paths = [p for p in files.split("\0") if p]
+    if not os.path.exists(path):
+        # Without a cached build, out/ only holds what configure built from
+        # these very sources.
+        age_paths(paths)
+        print(f"Restored timestamps for {len(paths)}/{len(paths)} files.")
+        return set()
+
+    with open(path, "r") as f:
+        changed = set(line.rstrip("\n") for line in f if line.strip())
+    unchanged = [p for p in paths if p not in changed]
+    age_paths(unchanged)
+    age_paths(sorted(changed), ref=path)
+    print(f"Restored timestamps for {len(unchanged)}/{len(paths)} files.")
+    return changed
+
+def file_hash(path):
+    h = hashlib.sha1()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1 << 16), b""):
+            h.update(chunk)
+    return h.hexdigest()
 
-    # 3. Write new hashes for the next build
-    new_hashes.sort(key=lambda x: x.split(" ", 1)[1])
+def crate_name(cmd_file):
+    # out/rust/.core.o.cmd -> core, out/rust/.libmacros.so.cmd -> macros
+    name = os.path.basename(cmd_file)[1:-len(".cmd")]
+    name = name.split(".", 1)[0]
+    if name.startswith("lib"):
+        name = name[len("lib"):]
+    return name
+
+def parse_deps(cmd_file):
+    deps = []
+    in_deps = False
+    with open(cmd_file, "r") as f:
+        for line in f:
+            line = line.strip()
+            # fixdep puts the first prerequisite, such as the crate root or
+            # the bindgen header, on its own line before the list.
+            if line.startswith("source_"):
+                source = line.split(":=", 1)[-1].strip()
+                if source:
+                    deps.append(source)
+                continue
+            if line.startswith("deps_"):
+                in_deps = True
+                continue
+            if not in_deps:
+                continue
+            entry = line.rstrip("\\").strip()
+            if entry and not entry.startswith("$("):
+                deps.append(entry)
+            if not line.endswith("\\"):
+                break
+    return deps
+
+def record_crates():
+    # Remember the sources each Rust crate was built from. Files inside the
+    # tree are covered by the git comparison; files outside it (the rust-src
+    # copy of 'core' in the sysroot) are reinstalled on every job, so keep
+    # their content hash to tell whether the crate really needs a rebuild.
+    srctree = os.path.realpath(".")
+    objtree = os.path.realpath(OUT_DIR)
+    lines = []
+    for cmd_file in sorted(glob.glob(os.path.join(OUT_DIR, "rust", ".*.cmd"))):
+        crate = crate_name(cmd_file)
+        if crate.endswith("_generated") or not crate:
+            continue
+        for dep in parse_deps(cmd_file):
+            path = os.path.realpath(os.path.join(objtree, dep))
+            if path.startswith(objtree + os.sep):
+                continue
+            if path.startswith(srctree + os.sep):
+                lines.append(f"{crate} - {os.path.relpath(path, srctree)}")
+            elif os.path.isfile(path):
+                lines.append(f"{crate} {file_hash(path)} {path}")
     try:
-        with open(HASH_FILE, "w") as f:
-            for item in new_hashes:
+        with open(CRATES_FILE, "w") as f:
+            for item in lines:
                 f.write(item + "\n")
     except Exception as e:
-        print(f"Error writing hashes.txt: {e}")
+        print(f"Error writing crates.txt: {e}")
+        return
+    print(f"Recorded {len(lines)} Rust crate dependencies.")
+
+def restore_crates(changed, ref=None):
+    if not os.path.exists(CRATES_FILE):
+        return
+
+    crates = {} # crate -> list of reasons it must be rebuilt
+    external = []
+    stale = []
+    with open(CRATES_FILE, "r") as f:
+        for line in f:
+            parts = line.strip().split(" ", 2)
+            if len(parts) != 3:
+                continue
+            crate, digest, path = parts
+            reasons = crates.setdefault(crate, [])
+            if digest == "-":
+                if path in changed:
+                    reasons.append(path)
+            elif os.path.isfile(path) and file_hash(path) == digest:
+                external.append(path)
+            else:
+                reasons.append(path)
+                stale.append(path)
+
+    age_paths(external)
+    if ref:
+        age_paths(stale, ref=ref)
+
+    for crate, reasons in sorted(crates.items()):
+        if reasons:
+            print(f"Rust crate {crate}: {len(reasons)} changed sources, e.g. {reasons[0]}")
+        else:
+            print(f"Rust crate {crate}: unchanged")
+
+def main():
+    parser = argparse.ArgumentParser()
+    mode = parser.add_mutually_exclusive_group()
+    mode.add_argument("--incremental", action="store_true",
+                      help="use git diff-tree against the stored tree")
+    mode.add_argument("--record-crates", action="store_true",
+                      help="record Rust crate sources after a build")
+    mode.add_argument("--from-changed", metavar="FILE",
+                      help="reuse the changed paths found by an earlier run on this tree")
+    parser.add_argument("--changed", metavar="FILE",
+                        help="write the paths changed since the previous build")
+    args = parser.parse_args()
+
+    if args.record_crates:
+        record_crates()
+        return
+
+    # The configure job hands its tree to the build and lint jobs, which
+    # must not save the state again.
+    if args.from_changed:
+        changed = restore_from_changed(args.from_changed)
+        restore_crates(changed, ref=args.from_changed)
+        return
+
+    # 1. Compare against the state of the previous build (restored from cache)
+    if args.incremental:
+        changed = restore_incremental()
+    else:
+        changed = restore_full()
+
+    # 2. Keep Rust crates whose sources did not change
+    restore_crates(changed or set())
+    if args.changed:
+        save_changed(args.changed, changed)
+
+    # 3. Write the new state for the next build
+    save_state()
 
 if __name__ == "__main__":
     main()
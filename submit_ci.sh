@@ -2,12 +2,34 @@
 set -e
 
 SLEEP_SEC=""
+JOBS=""
+BISECT=""
+POLL_SEC=60
+# How long to wait for GitHub to start a run for a pushed commit
+START_TIMEOUT=900
+BENCH_THRESHOLD=15
 while [[ $# -gt 0 ]]; do
   case $1 in
     -s|--sleep)
       SLEEP_SEC="$2"
       shift 2
       ;;
+    -j|--jobs)
+      JOBS="$2"
+      shift 2
+      ;;
+    -p|--poll)
+      POLL_SEC="$2"
+      shift 2
+      ;;
+    -t|--bench-threshold)
+      BENCH_THRESHOLD="$2"
+      shift 2
+      ;;
+    -b|--bisect)
+      BISECT=1
+      shift
+      ;;
     *)
       break
       ;;
@@ -15,8 +37,26 @@ while [[ $# -gt 0 ]]; do
 done
 
 if [[ $# -lt 2 ]]; then
-  echo "Usage: $0 [-s seconds] <base-commit> <tip-commit>"
+  echo "Usage: $0 [-s seconds] [-j jobs [-t percent] | -b] [-p seconds] <base-commit> <tip-commit>"
   echo "Example: $0 origin/master b4/driver-types"
+  echo ""
+  echo "  -s, --sleep   wait this long between pushes instead of asking"
+  echo "  -j, --jobs    push every commit to its own ci/batch/<sha> branch and"
+  echo "                keep this many CI runs in flight at once"
+  echo "  -t, --bench-threshold"
+  echo "                with --jobs, mark a commit as regressed when a benchmark"
+  echo "                on x86_64 gets worse by more than this many percent, or by"
+  echo "                more than its runs spread over (default 15); the base"
+  echo "                commit is run as well, for the first commit to compare to"
+  echo "  -b, --bisect  test the tip only, and on failure binary search the range"
+  echo "                for the first failing commit"
+  echo "  -p, --poll    seconds between run status checks with --jobs or --bisect"
+  echo "                (default 60)"
+  exit 1
+fi
+
+if [[ -n "$BISECT" && -n "$JOBS" ]]; then
+  echo "Error: --jobs and --bisect cannot be combined."
   exit 1
 fi
 
@@ -44,44 +84,314 @@ fi
 
 echo "Found $(echo "$COMMITS" | wc -l) commits to test."
 
-for COMMIT in $COMMITS; do
-  SHORT_COMMIT=$(echo "$COMMIT" | cut -c1-12)
-  COMMIT_SUBJECT=$(cd linux && git show -s --format=%s "$COMMIT")
-  echo "========================================"
-  echo "Processing submodule commit $SHORT_COMMIT: $COMMIT_SUBJECT"
-  echo "========================================"
-  
-  # 1. Prepare Submodule
-  echo "Preparing submodule..."
+# Check out a submodule commit with the fixes merged on top and push it to
+# the given ref. Prints the resulting submodule commit.
+#
+# These helpers are called in command substitutions, where set -e does not
+# apply, so every step checks its own status.
+prepare_submodule() {
+  local commit="$1" ref="$2"
   (
-    cd linux
-    git checkout --detach "$COMMIT" > /dev/null 2>&1
+    cd linux || exit 1
+    if ! git checkout --detach "$commit" > /dev/null 2>&1; then
+      echo "Error: could not check out $commit in the linux submodule." >&2
+      exit 1
+    fi
     # Merge fixes
-    git merge --no-edit ci/base-fixes > /dev/null
+    if ! git merge --no-edit ci/base-fixes > /dev/null; then
+      git merge --abort > /dev/null 2>&1
+      echo "Error: ci/base-fixes does not merge cleanly into $commit." >&2
+      exit 1
+    fi
     # Push to a stable ref for the submodule
-    git push --force origin HEAD:refs/heads/ci/fixes
+    if ! git push --force origin "HEAD:refs/heads/$ref" >&2; then
+      echo "Error: could not push the submodule to $ref." >&2
+      exit 1
+    fi
+    git rev-parse HEAD
   )
+}
 
-  # 2. Update Parent
-  echo "Updating parent repository..."
-  git add linux
-  # Amend the previous commit to avoid creating a huge history in the parent if running repeatedly? 
-  # The user said "final history in the parent repository... is linear".
-  # If we just keep making new commits, we get a linear history.
-  git commit -m "$SHORT_COMMIT: $COMMIT_SUBJECT"
-
-  # 3. Push Parent
-  echo "Pushing to CI..."
-  git push --force origin ci/actions
-
-  # 4. Wait
-  if [[ -n "$SLEEP_SEC" ]]; then
-    echo "Sleeping for $SLEEP_SEC seconds..."
-    sleep "$SLEEP_SEC"
-  else
-    echo "Check GitHub Actions: https://github.com/Darksonn/linux/actions"
-    read -p "Press Enter when the CI job has started to proceed to the next commit..."
+# Create a parent commit on top of HEAD that points the submodule at the
+# given commit, without touching the current branch or index.
+make_parent_commit() {
+  local submodule_commit="$1" message="$2"
+  local index tree
+  index=$(mktemp) || return 1
+  if ! GIT_INDEX_FILE="$index" git read-tree HEAD ||
+     ! GIT_INDEX_FILE="$index" git update-index --add --cacheinfo "160000,$submodule_commit,linux" ||
+     ! tree=$(GIT_INDEX_FILE="$index" git write-tree); then
+    rm -f "$index"
+    echo "Error: could not create the parent commit for $submodule_commit." >&2
+    return 1
   fi
-done
+  rm -f "$index"
+  git commit-tree "$tree" -p HEAD -m "$message"
+}
+
+# ci/batch branches pushed so far, by short commit
+declare -A PARENT_REFS=() SUBMODULE_REFS=()
+
+# Delete the ci/batch branch of a commit in both repositories once its run
+# has finished.
+delete_batch_ref() {
+  local ref="ci/batch/$1"
+  if [[ -n "${PARENT_REFS[$1]}" ]]; then
+    unset 'PARENT_REFS[$1]'
+    git push --quiet origin --delete "$ref" ||
+      echo "Warning: could not delete $ref in the parent repository." >&2
+  fi
+  if [[ -n "${SUBMODULE_REFS[$1]}" ]]; then
+    unset 'SUBMODULE_REFS[$1]'
+    (cd linux && git push --quiet origin --delete "$ref") ||
+      echo "Warning: could not delete $ref in the linux submodule." >&2
+  fi
+}
+
+# Run on exit, so an error or Ctrl-C does not leave branches behind.
+delete_batch_refs() {
+  local short_commit
+  for short_commit in "${!SUBMODULE_REFS[@]}" "${!PARENT_REFS[@]}"; do
+    delete_batch_ref "$short_commit"
+  done
+}
+
+# Print "<status> <conclusion>" of the latest run for a parent commit, or
+# nothing if GitHub has not picked it up yet.
+run_state() {
+  gh run list --commit "$1" --limit 1 --json status,conclusion \
+    --jq '.[0] | select(.) | "\(.status) \(.conclusion)"'
+}
+
+# Print the id of the latest run for a parent commit.
+run_id() {
+  gh run list --commit "$1" --limit 1 --json databaseId --jq '.[0].databaseId'
+}
+
+# Wait for the run of a parent commit to finish and print its conclusion.
+# Fails if no run shows up within START_TIMEOUT seconds.
+wait_for_run() {
+  local state start=$SECONDS
+  while true; do
+    sleep "$POLL_SEC"
+    state=$(run_state "$1")
+    if [[ "$state" == completed* ]]; then
+      echo "${state#completed }"
+      return
+    fi
+    if [[ -z "$state" && $((SECONDS - start)) -ge $START_TIMEOUT ]]; then
+      echo "Error: no CI run showed up for $1 within $START_TIMEOUT seconds." >&2
+      return 1
+    fi
+  done
+}
+
+run_sequential() {
+  for COMMIT in $COMMITS; do
+    SHORT_COMMIT=$(echo "$COMMIT" | cut -c1-12)
+    COMMIT_SUBJECT=$(cd linux && git show -s --format=%s "$COMMIT")
+    echo "========================================"
+    echo "Processing submodule commit $SHORT_COMMIT: $COMMIT_SUBJECT"
+    echo "========================================"
+
+    # 1. Prepare Submodule
+    echo "Preparing submodule..."
+    prepare_submodule "$COMMIT" ci/fixes > /dev/null
+
+    # 2. Update Parent
+    echo "Updating parent repository..."
+    git add linux
+    # Amend the previous commit to avoid creating a huge history in the parent if running repeatedly?
+    # The user said "final history in the parent repository... is linear".
+    # If we just keep making new commits, we get a linear history.
+    git commit -m "$SHORT_COMMIT: $COMMIT_SUBJECT"
+
+    # 3. Push Parent
+    echo "Pushing to CI..."
+    git push --force origin ci/actions
+
+    # 4. Wait
+    if [[ -n "$SLEEP_SEC" ]]; then
+      echo "Sleeping for $SLEEP_SEC seconds..."
+      sleep "$SLEEP_SEC"
+    else
+      echo "Check GitHub Actions: https://github.com/Darksonn/linux/actions"
+      read -p "Press Enter when the CI job has started to proceed to the next commit..."
+    fi
+  done
+}
+
+run_batch() {
+  local -a queue=($COMMITS)
+  local -a order=()
+  local -A parent=() subject=() result=() pushed=()
+  local -a running=()
+  local base short_base
+
+  # The base commit gets a run too, so the benchmarks of the first commit
+  # have something to be compared with. It goes first in the order.
+  base=$(cd linux && git rev-parse --verify "${BASE_COMMIT}^{commit}") || exit 1
+  short_base=$(echo "$base" | cut -c1-12)
+
+  # Merging needs the submodule worktree, so prepare every commit and push
+  # its submodule ref up front; only the CI runs themselves overlap.
+  for COMMIT in "$base" "${queue[@]}"; do
+    SHORT_COMMIT=$(echo "$COMMIT" | cut -c1-12)
+    subject[$SHORT_COMMIT]=$(cd linux && git show -s --format=%s "$COMMIT")
+    echo "Preparing $SHORT_COMMIT: ${subject[$SHORT_COMMIT]}"
+    SUBMODULE_COMMIT=$(prepare_submodule "$COMMIT" "ci/batch/$SHORT_COMMIT") || exit 1
+    SUBMODULE_REFS[$SHORT_COMMIT]=1
+    parent[$SHORT_COMMIT]=$(make_parent_commit "$SUBMODULE_COMMIT" \
+      "$SHORT_COMMIT: ${subject[$SHORT_COMMIT]}") || exit 1
+    order+=("$SHORT_COMMIT")
+  done
+
+  local next=0
+  while [[ $next -lt ${#order[@]} || ${#running[@]} -gt 0 ]]; do
+    # Start runs until the limit is reached.
+    while [[ $next -lt ${#order[@]} && ${#running[@]} -lt $JOBS ]]; do
+      SHORT_COMMIT=${order[$next]}
+      echo "Pushing $SHORT_COMMIT to ci/batch/$SHORT_COMMIT..."
+      git push --force --quiet origin "${parent[$SHORT_COMMIT]}:refs/heads/ci/batch/$SHORT_COMMIT"
+      PARENT_REFS[$SHORT_COMMIT]=1
+      pushed[$SHORT_COMMIT]=$SECONDS
+      running+=("$SHORT_COMMIT")
+      next=$((next + 1))
+    done
+
+    sleep "$POLL_SEC"
+
+    local -a still_running=()
+    for SHORT_COMMIT in "${running[@]}"; do
+      STATE=$(run_state "${parent[$SHORT_COMMIT]}")
+      if [[ "$STATE" == completed* ]]; then
+        result[$SHORT_COMMIT]=${STATE#completed }
+        echo "$SHORT_COMMIT finished: ${result[$SHORT_COMMIT]}"
+        delete_batch_ref "$SHORT_COMMIT"
+      elif [[ -z "$STATE" && $((SECONDS - ${pushed[$SHORT_COMMIT]})) -ge $START_TIMEOUT ]]; then
+        result[$SHORT_COMMIT]="no-run"
+        echo "$SHORT_COMMIT: no CI run showed up within $START_TIMEOUT seconds"
+        delete_batch_ref "$SHORT_COMMIT"
+      else
+        still_running+=("$SHORT_COMMIT")
+      fi
+    done
+    running=("${still_running[@]}")
+  done
+
+  # Compare the benchmarks of each commit with those of the one before it,
+  # starting with the base. Only x86_64 runs under KVM; the arm64 numbers
+  # are too noisy to judge.
+  local bench_dir prev=""
+  bench_dir=$(mktemp -d)
+  for SHORT_COMMIT in "${order[@]}"; do
+    gh run download "$(run_id "${parent[$SHORT_COMMIT]}")" -D "$bench_dir/$SHORT_COMMIT" \
+      -n bench-x86_64 > /dev/null 2>&1 || true
+    local old="$bench_dir/$prev/bench.json"
+    local new="$bench_dir/$SHORT_COMMIT/bench.json"
+    if [[ -n "$prev" && -f "$old" && -f "$new" ]]; then
+      echo "Benchmarks of $SHORT_COMMIT against $prev:"
+      if ! python3 .github/scripts/bench_compare.py --threshold "$BENCH_THRESHOLD" "$old" "$new" &&
+          [[ "${result[$SHORT_COMMIT]}" == "success" ]]; then
+        result[$SHORT_COMMIT]="regressed"
+      fi
+    fi
+    prev=$SHORT_COMMIT
+  done
+  echo "Benchmark results are in $bench_dir"
+
+  echo "========================================"
+  printf "%-12s  %-10s  %s\n" "COMMIT" "RESULT" "SUBJECT"
+  local failed=0
+  for SHORT_COMMIT in "${order[@]}"; do
+    # The base is not part of the series, so it does not fail it.
+    if [[ "$SHORT_COMMIT" == "$short_base" ]]; then
+      printf "%-12s  %-10s  (base) %s\n" "$SHORT_COMMIT" "${result[$SHORT_COMMIT]}" "${subject[$SHORT_COMMIT]}"
+      continue
+    fi
+    printf "%-12s  %-10s  %s\n" "$SHORT_COMMIT" "${result[$SHORT_COMMIT]}" "${subject[$SHORT_COMMIT]}"
+    [[ "${result[$SHORT_COMMIT]}" == "success" ]] || failed=1
+  done
+  return $failed
+}
+
+run_bisect() {
+  local -a order=($COMMITS)
+  local -A subject=() result=()
+  local -a tested=()
+
+  # Test order[$1] through the batch machinery and record its conclusion.
+  # This runs as an if condition, so set -e is off; a commit that cannot be
+  # tested aborts the bisection instead of counting as a failure.
+  test_index() {
+    local commit=${order[$1]}
+    local short_commit submodule_commit parent_commit
+    short_commit=$(echo "$commit" | cut -c1-12)
+    subject[$short_commit]=$(cd linux && git show -s --format=%s "$commit")
+    echo "Testing $short_commit: ${subject[$short_commit]}"
+    if ! submodule_commit=$(prepare_submodule "$commit" "ci/batch/$short_commit"); then
+      echo "Error: could not push $short_commit for testing, aborting." >&2
+      exit 1
+    fi
+    SUBMODULE_REFS[$short_commit]=1
+    if ! parent_commit=$(make_parent_commit "$submodule_commit" \
+           "$short_commit: ${subject[$short_commit]}") ||
+       ! git push --force --quiet origin "$parent_commit:refs/heads/ci/batch/$short_commit"; then
+      echo "Error: could not push $short_commit for testing, aborting." >&2
+      exit 1
+    fi
+    PARENT_REFS[$short_commit]=1
+    if ! result[$short_commit]=$(wait_for_run "$parent_commit"); then
+      delete_batch_ref "$short_commit"
+      echo "Error: $short_commit was not tested, aborting." >&2
+      exit 1
+    fi
+    delete_batch_ref "$short_commit"
+    echo "$short_commit finished: ${result[$short_commit]}"
+    tested+=("$short_commit")
+    [[ "${result[$short_commit]}" == "success" ]]
+  }
+
+  # This assumes that once a commit breaks the build, every later commit in
+  # the series stays broken.
+  local lo=0 hi=$((${#order[@]} - 1)) mid
+  local first_bad=""
+  if ! test_index "$hi"; then
+    while [[ $lo -lt $hi ]]; do
+      mid=$(((lo + hi) / 2))
+      if test_index "$mid"; then
+        lo=$((mid + 1))
+      else
+        hi=$mid
+      fi
+    done
+    first_bad=$(echo "${order[$hi]}" | cut -c1-12)
+  fi
+
+  echo "========================================"
+  printf "%-12s  %-10s  %s\n" "COMMIT" "RESULT" "SUBJECT"
+  for short_commit in "${tested[@]}"; do
+    printf "%-12s  %-10s  %s\n" "$short_commit" "${result[$short_commit]}" "${subject[$short_commit]}"
+  done
+  echo "Tested ${#tested[@]} of ${#order[@]} commits."
+  if [[ -n "$first_bad" ]]; then
+    echo "First failing commit: $first_bad: ${subject[$first_bad]}"
+    return 1
+  fi
+  echo "Tip passed, assuming the whole series passes."
+}
+
+if [[ -n "$BISECT" || -n "$JOBS" ]]; then
+  trap delete_batch_refs EXIT
+  trap 'exit 130' INT TERM
+fi
+
+if [[ -n "$BISECT" ]]; then
+  run_bisect
+elif [[ -n "$JOBS" ]]; then
+  run_batch
+else
+  run_sequential
+fi
 
 echo "Done!"